@@ -0,0 +1,432 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <array>
+#include <limits>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <span>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <csignal>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "messages.h"
+#include "cipher.h"
+
+// Wire traffic capture file format:
+//  - CaptureFileHeader
+//  - sequence of CaptureRecordHeader, each followed by frame_size bytes
+//    of the received frame (MessageHeader included). A record with
+//    frame_size 0 marks the connection as closed.
+//
+// NOTE: capture files must be handled as sensitive data. Frames are
+// recorded as received, and redacted login credentials keep the byte sums
+// of the original ones (which is all the cipher key depends on), so echo
+// message contents can be decrypted from the capture file alone (running
+// cipher_helper with the placeholder credentials), and the checksums of
+// the credentials are leaked. With CaptureWriter::Credentials::Keep,
+// credentials are stored in plaintext.
+
+#pragma pack(push, 1)
+
+struct CaptureFileHeader
+{
+    using MagicType = std::array<char, 4>;
+    static constexpr MagicType Magic = {'Q', 'S', 'C', 'P'};
+    static constexpr std::uint16_t CurrentVersion = 1;
+
+    MagicType magic = Magic;
+    std::uint16_t version = CurrentVersion;
+};
+
+struct CaptureRecordHeader
+{
+    std::uint64_t timestamp_ns; // since the start of the capture
+    std::uint32_t connection_id;
+    MessageHeader::SizeType frame_size;
+};
+
+#pragma pack(pop)
+
+constexpr auto MaxCaptureRecordSize = sizeof(CaptureRecordHeader) + std::numeric_limits<MessageHeader::SizeType>::max();
+
+// Replaces a credential with a placeholder with the same byte sum, which is
+// all the cipher key depends on, so that echo requests following a login
+// are processed as recorded when replayed
+template <typename T>
+void redact_credential(T &credential)
+{
+    constexpr std::string_view Placeholder = "redacted";
+    constexpr std::uint8_t MinChar = '!', MaxChar = '~';
+
+    const auto sum = sum_buffer<char>(credential);
+
+    credential = {};
+    std::copy(Placeholder.begin(), Placeholder.end(), credential.begin());
+
+    // append up to 3 printable chars to make up the difference (mod 256)
+    const auto remainder = static_cast<std::uint8_t>(sum - sum_buffer<char>(credential));
+    for (std::size_t num_chars = 0; num_chars <= 3; ++num_chars)
+        for (auto value = std::size_t{remainder}; value <= num_chars * MaxChar; value += 256)
+            if (value >= num_chars * MinChar)
+            {
+                auto extra = value - num_chars * MinChar;
+                for (std::size_t ndx = 0; ndx != num_chars; ++ndx)
+                {
+                    const auto inc = std::min<std::size_t>(extra, MaxChar - MinChar);
+                    credential[Placeholder.size() + ndx] = static_cast<char>(MinChar + inc);
+                    extra -= inc;
+                }
+                return;
+            }
+}
+
+// Records frames into a capture file. Records are appended to an
+// in-memory buffer, which is handed over to a background writer thread
+// (swapping it with a second buffer, both allocated once) when it's full
+// or periodically, so the cost on the request path is a lock & memcpy.
+// Request threads only block if the writer falls behind the disk.
+// Safe to use from multiple threads.
+class CaptureWriter
+{
+public:
+    static constexpr std::size_t DefaultBufferSize = 1 << 20;
+    static constexpr auto FlushInterval = std::chrono::seconds(1);
+
+    enum class Credentials
+    {
+        Redact, // replace login credentials with placeholders
+        Keep,   // record login credentials in plaintext
+    };
+
+    explicit CaptureWriter(const std::string &path, const std::size_t buffer_size = DefaultBufferSize, const Credentials credentials = Credentials::Redact)
+        : file_{std::fopen(path.c_str(), "wb")}, credentials_{credentials},
+          active_(std::max(buffer_size, MaxCaptureRecordSize)),
+          pending_(active_.size())
+    {
+        if (file_ == nullptr)
+        {
+            perror("Error opening capture file");
+            return;
+        }
+
+        const CaptureFileHeader file_header;
+        std::memcpy(active_.data(), &file_header, sizeof(file_header));
+        active_used_ = sizeof(file_header);
+
+        // NOTE: the writer thread is started with all signals blocked (it
+        // inherits the mask), so that process-directed signals (e.g. SIGTERM)
+        // are never delivered to it, regardless of the caller's mask. This
+        // lets the application handle them (e.g. flushing the capture).
+        sigset_t all_signals, prev_signals;
+        sigfillset(&all_signals);
+        pthread_sigmask(SIG_BLOCK, &all_signals, &prev_signals);
+        writer_ = std::thread([this]()
+                              { write_loop(); });
+        pthread_sigmask(SIG_SETMASK, &prev_signals, nullptr);
+    }
+
+    ~CaptureWriter()
+    {
+        if (file_ == nullptr)
+            return;
+
+        flush();
+
+        {
+            std::lock_guard lock{mutex_};
+            stop_ = true;
+        }
+        cv_.notify_all();
+        writer_.join();
+
+        std::fclose(file_);
+    }
+
+    CaptureWriter(const CaptureWriter &) = delete;
+    CaptureWriter &operator=(const CaptureWriter &) = delete;
+
+    bool is_open() const { return file_ != nullptr; }
+
+    void record_frame(const std::uint32_t connection_id, std::span<const std::uint8_t> frame)
+    {
+        append(connection_id, frame);
+    }
+
+    void record_close(const std::uint32_t connection_id)
+    {
+        append(connection_id, {});
+    }
+
+    // writes all the records appended so far to the file
+    void flush()
+    {
+        if (file_ == nullptr)
+            return;
+
+        std::unique_lock lock{mutex_};
+        cv_.wait(lock, [this]
+                 { return pending_used_ == 0; });
+        swap_buffers();
+        cv_.wait(lock, [this]
+                 { return pending_used_ == 0; });
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void append(const std::uint32_t connection_id, std::span<const std::uint8_t> frame)
+    {
+        if (file_ == nullptr)
+            return;
+
+        std::unique_lock lock{mutex_};
+
+        const auto record_size = sizeof(CaptureRecordHeader) + frame.size();
+        if (active_.size() - active_used_ < record_size)
+        {
+            cv_.wait(lock, [this]
+                     { return pending_used_ == 0; });
+            swap_buffers();
+        }
+
+        // NOTE: timestamp is taken while holding the lock (and after waiting,
+        // which releases it) so that records are written in timestamp order
+        const auto now = Clock::now();
+
+        const CaptureRecordHeader record_header{
+            static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - start_).count()),
+            connection_id,
+            static_cast<MessageHeader::SizeType>(frame.size())};
+
+        const auto record_frame = active_.data() + active_used_ + sizeof(record_header);
+        std::memcpy(active_.data() + active_used_, &record_header, sizeof(record_header));
+        if (frame.empty() == false)
+            std::memcpy(record_frame, frame.data(), frame.size());
+        active_used_ += record_size;
+
+        // NOTE: redacted in the capture buffer (the received frame isn't modified)
+        if (credentials_ == Credentials::Redact && frame.size() == sizeof(LoginRequestMsg))
+        {
+            auto &msg = *reinterpret_cast<LoginRequestMsg *>(record_frame);
+            if (msg.header.type == LoginRequestMsg::Type)
+            {
+                redact_credential(msg.body.username);
+                redact_credential(msg.body.password);
+            }
+        }
+    }
+
+    // hands the active buffer over to the writer thread
+    // NOTE: must be called with the lock held & no pending buffer
+    void swap_buffers()
+    {
+        if (active_used_ == 0)
+            return;
+
+        std::swap(active_, pending_);
+        pending_used_ = active_used_;
+        active_used_ = 0;
+        cv_.notify_all();
+    }
+
+    void write_loop()
+    {
+        std::unique_lock lock{mutex_};
+
+        while (true)
+        {
+            cv_.wait_for(lock, FlushInterval, [this]
+                         { return pending_used_ != 0 || stop_ == true; });
+
+            // periodic flush, so that records don't stay in memory under low load
+            if (pending_used_ == 0)
+                swap_buffers();
+
+            if (pending_used_ != 0)
+            {
+                // NOTE: pending buffer isn't touched by other threads until
+                // it's released, so it's written without holding the lock
+                lock.unlock();
+                if (std::fwrite(pending_.data(), 1, pending_used_, file_) != pending_used_)
+                    perror("Error writing capture file");
+                std::fflush(file_);
+                lock.lock();
+
+                pending_used_ = 0;
+                cv_.notify_all();
+            }
+            else if (stop_ == true)
+                break;
+        }
+    }
+
+    std::FILE *file_;
+    const Credentials credentials_;
+    std::vector<std::uint8_t> active_;  // appended to by request threads
+    std::vector<std::uint8_t> pending_; // being written by the writer thread
+    std::size_t active_used_ = 0;
+    std::size_t pending_used_ = 0;
+    const Clock::time_point start_ = Clock::now();
+    bool stop_ = false;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread writer_;
+};
+
+struct CaptureRecord
+{
+    const CaptureRecordHeader &header;
+    std::uint32_t connection_ndx; // dense index of header.connection_id (0..num_connections - 1)
+    std::span<const std::uint8_t> frame;
+
+    bool is_close() const { return frame.empty(); }
+};
+
+// Memory-maps a capture file for replay. The file is validated once when
+// opened, so iterating the records afterwards just walks the mapping.
+class CaptureReader
+{
+public:
+    explicit CaptureReader(const std::string &path)
+    {
+        const auto fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            perror("Error opening capture file");
+            return;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == -1)
+        {
+            perror("Error reading capture file size");
+            close(fd);
+            return;
+        }
+
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ != 0)
+        {
+            auto data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED)
+                perror("Error mapping capture file");
+            else
+            {
+                data_ = static_cast<const std::uint8_t *>(data);
+                madvise(data, size_, MADV_SEQUENTIAL);
+            }
+        }
+
+        close(fd);
+
+        valid_ = validate();
+    }
+
+    ~CaptureReader()
+    {
+        if (data_ != nullptr)
+            munmap(const_cast<std::uint8_t *>(data_), size_);
+    }
+
+    CaptureReader(const CaptureReader &) = delete;
+    CaptureReader &operator=(const CaptureReader &) = delete;
+
+    bool is_valid() const { return valid_; }
+    std::size_t num_records() const { return num_records_; }
+    // NOTE: connection ids are remapped into dense indexes (see CaptureRecord),
+    // so that per-connection state can be kept in arrays of this size
+    std::size_t num_connections() const { return num_connections_; }
+    // NOTE: timestamps are relative to the start of the capture (not to the
+    // first record), so replay pacing should be relative to this one
+    std::uint64_t first_timestamp_ns() const { return first_timestamp_ns_; }
+
+    // NOTE: only to be used on a valid capture
+    template <typename Func>
+    void for_each_record(Func func) const
+    {
+        auto connection_ndx = connection_ndxs_.begin();
+        for (auto offset = sizeof(CaptureFileHeader); offset != size_; ++connection_ndx)
+        {
+            const auto &record_header = *reinterpret_cast<const CaptureRecordHeader *>(data_ + offset);
+            offset += sizeof(CaptureRecordHeader);
+
+            func(CaptureRecord{record_header, *connection_ndx, {data_ + offset, record_header.frame_size}});
+            offset += record_header.frame_size;
+        }
+    }
+
+private:
+    bool validate()
+    {
+        if (data_ == nullptr || size_ < sizeof(CaptureFileHeader))
+            return false;
+
+        const auto &file_header = *reinterpret_cast<const CaptureFileHeader *>(data_);
+        if (file_header.magic != CaptureFileHeader::Magic || file_header.version != CaptureFileHeader::CurrentVersion)
+            return false;
+
+        std::unordered_map<std::uint32_t, std::uint32_t> connection_ndxs;
+        std::uint64_t last_timestamp_ns = 0;
+
+        for (auto offset = sizeof(CaptureFileHeader); offset != size_;)
+        {
+            if (size_ - offset < sizeof(CaptureRecordHeader))
+                return false;
+
+            const auto &record_header = *reinterpret_cast<const CaptureRecordHeader *>(data_ + offset);
+            offset += sizeof(CaptureRecordHeader);
+
+            // records are written in timestamp order
+            if (record_header.timestamp_ns < last_timestamp_ns)
+                return false;
+
+            const auto frame_size = record_header.frame_size;
+            if (size_ - offset < frame_size)
+                return false;
+
+            // frames must hold at least a header consistent with the record
+            if (frame_size != 0)
+            {
+                if (frame_size < sizeof(MessageHeader))
+                    return false;
+                const auto &msg_header = *reinterpret_cast<const MessageHeader *>(data_ + offset);
+                if (msg_header.size != frame_size)
+                    return false;
+            }
+
+            offset += frame_size;
+            if (num_records_ == 0)
+                first_timestamp_ns_ = record_header.timestamp_ns;
+            last_timestamp_ns = record_header.timestamp_ns;
+
+            const auto [it, _] = connection_ndxs.try_emplace(record_header.connection_id, static_cast<std::uint32_t>(connection_ndxs.size()));
+            connection_ndxs_.push_back(it->second);
+            ++num_records_;
+        }
+
+        num_connections_ = connection_ndxs.size();
+        return true;
+    }
+
+    const std::uint8_t *data_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t num_records_ = 0;
+    std::size_t num_connections_ = 0;
+    std::vector<std::uint32_t> connection_ndxs_; // for each record
+    std::uint64_t first_timestamp_ns_ = 0;
+    bool valid_ = false;
+};
@@ -0,0 +1,293 @@
+#include "capture.h"
+#include "misc.h"
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <string_view>
+#include <csignal>
+#include <sys/wait.h>
+
+#define BOOST_TEST_MODULE Capture Tests
+#include <boost/test/included/unit_test.hpp>
+
+const auto capture_path = (std::filesystem::temp_directory_path() / "capture_tests.bin").string();
+
+BOOST_AUTO_TEST_CASE(capture_round_trip_test)
+{
+    const auto login_msg = make_msg<LoginRequestMsg>(0);
+    auto echo_msg = make_echo_req_msg(1, 4);
+    std::memcpy(echo_msg.body.message.data(), "test", 4);
+
+    {
+        // NOTE: keep credentials, so that frames are recorded unmodified
+        CaptureWriter capture{capture_path, CaptureWriter::DefaultBufferSize, CaptureWriter::Credentials::Keep};
+        BOOST_TEST(capture.is_open() == true);
+
+        capture.record_frame(7, msg_frame(login_msg));
+        capture.record_frame(3, msg_frame(echo_msg));
+        capture.record_close(7);
+    }
+
+    const CaptureReader capture{capture_path};
+    BOOST_TEST(capture.is_valid() == true);
+    BOOST_TEST(capture.num_records() == 3);
+    BOOST_TEST(capture.num_connections() == 2);
+    // capture starts when the writer is created, not on the first record
+    BOOST_TEST(capture.first_timestamp_ns() > 0);
+
+    std::vector<std::uint32_t> connection_ids, connection_ndxs;
+    std::vector<std::vector<std::uint8_t>> frames;
+    auto last_timestamp = capture.first_timestamp_ns();
+
+    capture.for_each_record([&](const CaptureRecord &record)
+                            {
+                                BOOST_TEST(record.header.timestamp_ns >= last_timestamp);
+                                last_timestamp = record.header.timestamp_ns;
+                                connection_ids.push_back(record.header.connection_id);
+                                connection_ndxs.push_back(record.connection_ndx);
+                                frames.emplace_back(record.frame.begin(), record.frame.end()); });
+
+    BOOST_TEST(connection_ids == (std::vector<std::uint32_t>{7, 3, 7}));
+    BOOST_TEST(connection_ndxs == (std::vector<std::uint32_t>{0, 1, 0}));
+
+    const auto login_frame = msg_frame(login_msg);
+    const auto echo_frame = msg_frame(echo_msg);
+    BOOST_TEST(frames[0] == std::vector<std::uint8_t>(login_frame.begin(), login_frame.end()));
+    BOOST_TEST(frames[1] == std::vector<std::uint8_t>(echo_frame.begin(), echo_frame.end()));
+    BOOST_TEST(frames[2].empty() == true);
+
+    std::filesystem::remove(capture_path);
+}
+
+BOOST_AUTO_TEST_CASE(capture_concurrent_writers_test)
+{
+    constexpr auto NUM_THREADS = 4;
+    constexpr auto NUM_FRAMES = 2000;
+
+    const auto echo_msg = make_echo_req_msg(1, 100);
+
+    {
+        // smallest buffer, so that buffers are handed over to the writer thread several times
+        CaptureWriter capture{capture_path, 0};
+
+        std::array<std::jthread, NUM_THREADS> threads;
+        for (auto ndx = 0; ndx != NUM_THREADS; ++ndx)
+            threads[ndx] = std::jthread([&capture, &echo_msg, ndx]()
+                                        {
+                                            for (auto i = 0; i != NUM_FRAMES; ++i)
+                                                capture.record_frame(ndx, msg_frame(echo_msg));
+                                            capture.record_close(ndx); });
+    }
+
+    const CaptureReader capture{capture_path};
+    BOOST_TEST(capture.is_valid() == true);
+    BOOST_TEST(capture.num_records() == NUM_THREADS * (NUM_FRAMES + 1));
+
+    std::array<std::size_t, NUM_THREADS> num_frames{};
+    auto last_timestamp = capture.first_timestamp_ns();
+    bool ordered = true;
+
+    capture.for_each_record([&](const CaptureRecord &record)
+                            {
+                                ordered = ordered && record.header.timestamp_ns >= last_timestamp;
+                                last_timestamp = record.header.timestamp_ns;
+                                if (record.is_close() == false)
+                                    num_frames[record.header.connection_id]++; });
+
+    BOOST_TEST(ordered == true);
+    for (const auto n : num_frames)
+        BOOST_TEST(n == NUM_FRAMES);
+
+    std::filesystem::remove(capture_path);
+}
+
+LoginRequestMsg record_login(const CaptureWriter::Credentials credentials)
+{
+    auto login_msg = make_msg<LoginRequestMsg>(0);
+    login_msg.body.username = init_credential<LoginRequestBody::UsernameType>("testuser");
+    login_msg.body.password = init_credential<LoginRequestBody::PasswordType>("testpass");
+
+    {
+        CaptureWriter capture{capture_path, CaptureWriter::DefaultBufferSize, credentials};
+        capture.record_frame(1, msg_frame(login_msg));
+    }
+
+    LoginRequestMsg recorded_msg{};
+    const CaptureReader capture{capture_path};
+    BOOST_TEST(capture.is_valid() == true);
+    capture.for_each_record([&](const CaptureRecord &record)
+                            {
+                                BOOST_TEST(record.frame.size() == sizeof(recorded_msg));
+                                std::memcpy(&recorded_msg, record.frame.data(), sizeof(recorded_msg)); });
+
+    std::filesystem::remove(capture_path);
+
+    // credentials must derive the same cipher key either way
+    BOOST_TEST(get_initial_key(87, recorded_msg.body.username, recorded_msg.body.password) ==
+               get_initial_key(87, login_msg.body.username, login_msg.body.password));
+
+    return recorded_msg;
+}
+
+BOOST_AUTO_TEST_CASE(capture_redacted_credentials_test)
+{
+    const auto recorded_msg = record_login(CaptureWriter::Credentials::Redact);
+    BOOST_TEST(std::string_view(recorded_msg.body.username.data()).starts_with("redacted"));
+    BOOST_TEST(std::string_view(recorded_msg.body.password.data()).starts_with("redacted"));
+}
+
+BOOST_AUTO_TEST_CASE(capture_kept_credentials_test)
+{
+    const auto recorded_msg = record_login(CaptureWriter::Credentials::Keep);
+    BOOST_TEST(std::string_view(recorded_msg.body.username.data()) == "testuser");
+    BOOST_TEST(std::string_view(recorded_msg.body.password.data()) == "testpass");
+}
+
+BOOST_AUTO_TEST_CASE(redact_credential_test)
+{
+    // every possible key sum must be preserved with a printable placeholder
+    for (auto sum = 0; sum != 256; ++sum)
+    {
+        LoginRequestBody::UsernameType credential{};
+        credential[0] = static_cast<char>(sum);
+        const auto expected_sum = sum_buffer<char>(credential);
+
+        redact_credential(credential);
+
+        const std::string_view placeholder{credential.data()};
+        BOOST_TEST(sum_buffer<char>(credential) == expected_sum);
+        BOOST_TEST(std::all_of(placeholder.begin(), placeholder.end(), [](char c)
+                               { return c >= '!' && c <= '~'; }));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(capture_flush_on_signal_test)
+{
+    // run the capture in a child process, flushing it on SIGTERM from a
+    // dedicated thread (as the server does)
+    std::array<int, 2> ready_pipe;
+    BOOST_REQUIRE(pipe(ready_pipe.data()) == 0);
+
+    const auto pid = fork();
+    BOOST_REQUIRE(pid != -1);
+
+    if (pid == 0)
+    {
+        std::signal(SIGTERM, SIG_DFL);
+
+        // NOTE: the writer is created before blocking the signals in this
+        // thread, so SIGTERM must not be delivered to the writer thread
+        const auto login_msg = make_msg<LoginRequestMsg>(0);
+        CaptureWriter capture{capture_path};
+        capture.record_frame(1, msg_frame(login_msg));
+
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        std::thread([signals, &capture]()
+                    {
+                        int signal;
+                        sigwait(&signals, &signal);
+                        capture.flush();
+                        std::_Exit(0); })
+            .detach();
+
+        const char ready = 1;
+        [[maybe_unused]] const auto ret = write(ready_pipe[1], &ready, 1);
+        while (true)
+            pause();
+    }
+
+    char ready;
+    BOOST_REQUIRE(read(ready_pipe[0], &ready, 1) == 1);
+    close(ready_pipe[0]);
+    close(ready_pipe[1]);
+
+    kill(pid, SIGTERM);
+    int status;
+    BOOST_REQUIRE(waitpid(pid, &status, 0) == pid);
+    BOOST_TEST((WIFEXITED(status) && WEXITSTATUS(status) == 0));
+
+    const CaptureReader capture{capture_path};
+    BOOST_TEST(capture.is_valid() == true);
+    BOOST_TEST(capture.num_records() == 1);
+
+    std::filesystem::remove(capture_path);
+}
+
+// writes a capture file with close records for the given (timestamp, connection id) pairs
+void write_capture_file(const std::vector<std::pair<std::uint64_t, std::uint32_t>> &records)
+{
+    std::ofstream file{capture_path, std::ios::binary};
+
+    const CaptureFileHeader file_header;
+    file.write(reinterpret_cast<const char *>(&file_header), sizeof(file_header));
+
+    for (const auto &[timestamp_ns, connection_id] : records)
+    {
+        const CaptureRecordHeader record_header{timestamp_ns, connection_id, 0};
+        file.write(reinterpret_cast<const char *>(&record_header), sizeof(record_header));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(capture_sparse_connection_ids_test)
+{
+    constexpr auto MaxConnectionId = std::numeric_limits<std::uint32_t>::max();
+    write_capture_file({{10, MaxConnectionId}, {20, 5}, {30, MaxConnectionId}});
+
+    const CaptureReader capture{capture_path};
+    BOOST_TEST(capture.is_valid() == true);
+    BOOST_TEST(capture.num_connections() == 2);
+    BOOST_TEST(capture.first_timestamp_ns() == 10);
+
+    std::vector<std::uint32_t> connection_ndxs;
+    capture.for_each_record([&](const CaptureRecord &record)
+                            { connection_ndxs.push_back(record.connection_ndx); });
+    BOOST_TEST(connection_ndxs == (std::vector<std::uint32_t>{0, 1, 0}));
+
+    std::filesystem::remove(capture_path);
+}
+
+BOOST_AUTO_TEST_CASE(capture_timestamps_backwards_test)
+{
+    write_capture_file({{20, 1}, {10, 2}});
+
+    const CaptureReader capture{capture_path};
+    BOOST_TEST(capture.is_valid() == false);
+
+    std::filesystem::remove(capture_path);
+}
+
+BOOST_AUTO_TEST_CASE(capture_truncated_test)
+{
+    const auto echo_msg = make_echo_req_msg(1, 4);
+
+    {
+        CaptureWriter capture{capture_path};
+        capture.record_frame(1, msg_frame(echo_msg));
+    }
+
+    // drop the last byte of the frame
+    std::filesystem::resize_file(capture_path, std::filesystem::file_size(capture_path) - 1);
+
+    const CaptureReader capture{capture_path};
+    BOOST_TEST(capture.is_valid() == false);
+
+    std::filesystem::remove(capture_path);
+}
+
+BOOST_AUTO_TEST_CASE(capture_bad_magic_test)
+{
+    {
+        std::ofstream file{capture_path, std::ios::binary};
+        file << "not a capture file";
+    }
+
+    const CaptureReader capture{capture_path};
+    BOOST_TEST(capture.is_valid() == false);
+
+    std::filesystem::remove(capture_path);
+}
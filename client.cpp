@@ -6,15 +6,23 @@
 #include <thread>
 #include <iomanip>
 #include <vector>
+#include <list>
+#include <memory>
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+#include <span>
 #include <cstring>
 #include <cassert>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <sys/epoll.h>
 
 #include "messages.h"
 #include "network.h"
 #include "cipher.h"
 #include "misc.h"
+#include "capture.h"
 #include "external/cxxopts.hpp"
 
 void login(const int client_socket, const LoginRequestBody::UsernameType &username, const LoginRequestBody::PasswordType &password, const std::uint8_t seq)
@@ -187,11 +195,391 @@ void benchmark_server()
     std::cout << "benchmark time: " << ms.count() << " ms\n";
 }
 
+// Open-loop replay of the capture connections assigned to one thread
+// (connection_ndx % num_shards == shard). Frames are sent on the recorded
+// schedule without waiting for their responses, which are drained through
+// epoll whenever the thread waits (for the next send time or for a socket
+// to become writable). Connections are owned by a single thread, so no
+// synchronization is needed.
+class ReplayShard
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats
+    {
+        std::size_t num_messages = 0;
+        std::size_t num_responses = 0;
+        std::size_t num_errors = 0;
+        std::size_t num_scheduled = 0;
+        Clock::duration max_lag{0}; // how far behind schedule records were replayed
+        Clock::duration total_lag{0};
+    };
+
+    ReplayShard(const CaptureReader &capture, const unsigned int num_shards, const unsigned int shard)
+        : capture_{capture}, num_shards_{num_shards}, shard_{shard},
+          epoll_fd_{epoll_create1(0)}, live_(capture.num_connections(), nullptr)
+    {
+        if (epoll_fd_ == -1)
+            perror("Error creating epoll instance");
+    }
+
+    ~ReplayShard()
+    {
+        for (const auto &connection : connections_)
+            if (connection.socket != -1)
+                close(connection.socket);
+
+        if (epoll_fd_ != -1)
+            close(epoll_fd_);
+    }
+
+    ReplayShard(const ReplayShard &) = delete;
+    ReplayShard &operator=(const ReplayShard &) = delete;
+
+    Stats run(const Clock::time_point start, const double speed)
+    {
+        if (epoll_fd_ == -1)
+        {
+            stats_.num_errors++;
+            return stats_;
+        }
+
+        capture_.for_each_record([&](const CaptureRecord &record)
+                                 {
+                                     if (record.connection_ndx % num_shards_ != shard_)
+                                         return;
+
+                                     // speed 0 replays as fast as possible
+                                     if (speed > 0)
+                                         wait_until(start + std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(record.header.timestamp_ns - capture_.first_timestamp_ns()) / speed));
+                                     else
+                                         poll_events(0);
+
+                                     replay_record(record); });
+
+        // stop sending on the remaining connections and wait for outstanding responses
+        for (auto &connection : live_)
+            if (connection != nullptr)
+                close_write(connection);
+
+        while (connections_.empty() == false && poll_events(DrainTimeoutMs) != 0)
+            ;
+
+        return stats_;
+    }
+
+private:
+    static constexpr int DrainTimeoutMs = 5000;
+    static constexpr int MaxEvents = 64;
+
+    struct Connection
+    {
+        int socket = -1;
+        bool write_closed = false; // closed by the capture, draining responses
+        bool failed = false;
+        bool writable = false;
+
+        // response parsing state
+        MessageHeader header;
+        std::size_t header_used = 0;
+        std::size_t body_remaining = 0;
+
+        std::list<Connection>::iterator self;
+    };
+
+    void wait_until(const Clock::time_point scheduled)
+    {
+        for (auto now = Clock::now(); now < scheduled; now = Clock::now())
+        {
+            const auto timeout_ms = std::chrono::duration_cast<std::chrono::milliseconds>(scheduled - now).count();
+            if (timeout_ms == 0)
+                std::this_thread::sleep_until(scheduled);
+            else
+                poll_events(static_cast<int>(timeout_ms));
+        }
+
+        const auto lag = Clock::now() - scheduled;
+        stats_.num_scheduled++;
+        stats_.max_lag = std::max(stats_.max_lag, lag);
+        stats_.total_lag += lag;
+    }
+
+    void replay_record(const CaptureRecord &record)
+    {
+        auto &connection = live_[record.connection_ndx];
+
+        // connection dropped by the server: reconnect on its next frame
+        if (connection != nullptr && connection->failed == true)
+            release(connection);
+
+        if (record.is_close() == true)
+        {
+            if (connection != nullptr)
+                close_write(connection);
+            return;
+        }
+
+        if (connection == nullptr)
+            connection = open_connection();
+
+        if (connection == nullptr)
+        {
+            stats_.num_errors++;
+            return;
+        }
+
+        if (send_frame(*connection, record.frame) == true)
+            stats_.num_messages++;
+        else
+        {
+            stats_.num_errors++;
+            release(connection);
+        }
+    }
+
+    Connection *open_connection()
+    {
+        const auto client_socket = connect_to_server();
+        if (client_socket == -1)
+            return nullptr;
+
+        auto &connection = connections_.emplace_back();
+        connection.socket = client_socket;
+        connection.self = std::prev(connections_.end());
+
+        if (update_events(connection, EPOLL_CTL_ADD, EPOLLIN) == false)
+        {
+            close(client_socket);
+            connections_.erase(connection.self);
+            return nullptr;
+        }
+
+        return &connection;
+    }
+
+    bool update_events(Connection &connection, const int op, const std::uint32_t events)
+    {
+        epoll_event event{};
+        event.events = events;
+        event.data.ptr = &connection;
+        if (epoll_ctl(epoll_fd_, op, connection.socket, &event) == -1)
+        {
+            perror("Error updating epoll events");
+            return false;
+        }
+        return true;
+    }
+
+    bool send_frame(Connection &connection, std::span<const std::uint8_t> frame)
+    {
+        while (frame.empty() == false)
+        {
+            const auto ret = send(connection.socket, frame.data(), frame.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (ret > 0)
+                frame = frame.subspan(static_cast<std::size_t>(ret));
+            else if (ret == -1 && errno == EINTR)
+                continue;
+            else if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                // socket buffer is full: keep draining responses (on every
+                // connection) until the server catches up
+                connection.writable = false;
+                if (update_events(connection, EPOLL_CTL_MOD, EPOLLIN | EPOLLOUT) == false)
+                    return false;
+                while (connection.writable == false && connection.failed == false)
+                    if (poll_events(DrainTimeoutMs) == 0)
+                        return false;
+                if (connection.failed == true || update_events(connection, EPOLL_CTL_MOD, EPOLLIN) == false)
+                    return false;
+            }
+            else
+                return false;
+        }
+
+        return true;
+    }
+
+    // returns the number of events handled (0 on timeout)
+    int poll_events(const int timeout_ms)
+    {
+        std::array<epoll_event, MaxEvents> events;
+        const auto num_events = epoll_wait(epoll_fd_, events.data(), MaxEvents, timeout_ms);
+        if (num_events == -1)
+        {
+            if (errno != EINTR)
+                perror("Error waiting for epoll events");
+            return 0;
+        }
+
+        for (auto ndx = 0; ndx != num_events; ++ndx)
+        {
+            auto &connection = *static_cast<Connection *>(events[ndx].data.ptr);
+
+            if (events[ndx].events & EPOLLOUT)
+                connection.writable = true;
+
+            if (events[ndx].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                receive(connection);
+        }
+
+        return num_events;
+    }
+
+    void receive(Connection &connection)
+    {
+        const auto ret = recv(connection.socket, rsp_buffer_.data(), rsp_buffer_.size(), MSG_DONTWAIT);
+        if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return;
+
+        if (ret > 0 && consume(connection, {rsp_buffer_.data(), static_cast<std::size_t>(ret)}) == true)
+            return;
+
+        // connection closed (or failed / malformed response)
+        const auto closed_cleanly = ret == 0 && connection.write_closed == true && connection.header_used == 0;
+        if (closed_cleanly == false)
+            stats_.num_errors++;
+
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection.socket, nullptr);
+        close(connection.socket);
+        connection.socket = -1;
+        connection.failed = true;
+
+        // NOTE: connections still used by the capture are released when next used
+        if (connection.write_closed == true)
+            connections_.erase(connection.self);
+    }
+
+    // parse the response stream just enough to count responses (their contents are discarded)
+    bool consume(Connection &connection, std::span<const std::uint8_t> data)
+    {
+        while (data.empty() == false)
+        {
+            if (connection.header_used < sizeof(MessageHeader))
+            {
+                const auto n = std::min(sizeof(MessageHeader) - connection.header_used, data.size());
+                std::memcpy(reinterpret_cast<std::uint8_t *>(&connection.header) + connection.header_used, data.data(), n);
+                connection.header_used += n;
+                data = data.subspan(n);
+
+                if (connection.header_used < sizeof(MessageHeader))
+                    break;
+                if (connection.header.size < sizeof(MessageHeader))
+                    return false;
+                connection.body_remaining = connection.header.size - sizeof(MessageHeader);
+            }
+
+            const auto n = std::min(connection.body_remaining, data.size());
+            connection.body_remaining -= n;
+            data = data.subspan(n);
+
+            if (connection.body_remaining == 0)
+            {
+                stats_.num_responses++;
+                connection.header_used = 0;
+            }
+        }
+
+        return true;
+    }
+
+    // the capture closed the connection: stop sending and let the server
+    // close it once outstanding requests are answered
+    void close_write(Connection *&connection)
+    {
+        if (connection->failed == true)
+            release(connection);
+        else
+        {
+            shutdown(connection->socket, SHUT_WR);
+            connection->write_closed = true;
+            connection = nullptr;
+        }
+    }
+
+    void release(Connection *&connection)
+    {
+        if (connection->socket != -1)
+        {
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection->socket, nullptr);
+            close(connection->socket);
+        }
+        connections_.erase(connection->self);
+        connection = nullptr;
+    }
+
+    const CaptureReader &capture_;
+    const unsigned int num_shards_;
+    const unsigned int shard_;
+    const int epoll_fd_;
+
+    std::list<Connection> connections_;   // owns all connections (including draining ones)
+    std::vector<Connection *> live_;      // live connection for each connection (index) in the capture
+    std::array<std::uint8_t, std::numeric_limits<MessageHeader::SizeType>::max()> rsp_buffer_;
+    Stats stats_;
+};
+
+int replay_capture(const std::string &path, const double speed, const unsigned int num_threads)
+{
+    const CaptureReader capture{path};
+    if (capture.is_valid() == false)
+    {
+        std::cerr << "Invalid capture file: " << path << std::endl;
+        return -1;
+    }
+
+    std::cout << "Replaying " << capture.num_records() << " records from " << path << std::endl;
+
+    std::vector<ReplayShard::Stats> stats(num_threads);
+
+    const auto t1 = ReplayShard::Clock::now();
+
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(num_threads);
+
+        for (unsigned int ndx = 0; ndx != num_threads; ++ndx)
+            // NOTE: the capture is mapped read-only, so it's safe to walk it concurrently
+            threads.emplace_back([&capture, &stats, t1, speed, num_threads, ndx]()
+                                 {
+                                     auto shard = std::make_unique<ReplayShard>(capture, num_threads, ndx);
+                                     stats[ndx] = shard->run(t1, speed); });
+    }
+
+    const auto t2 = ReplayShard::Clock::now();
+    const std::chrono::duration<double, std::milli> ms = t2 - t1;
+
+    ReplayShard::Stats total;
+    for (const auto &shard_stats : stats)
+    {
+        total.num_messages += shard_stats.num_messages;
+        total.num_responses += shard_stats.num_responses;
+        total.num_errors += shard_stats.num_errors;
+        total.num_scheduled += shard_stats.num_scheduled;
+        total.max_lag = std::max(total.max_lag, shard_stats.max_lag);
+        total.total_lag += shard_stats.total_lag;
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "replayed messages: " << total.num_messages << ", responses: " << total.num_responses << ", errors: " << total.num_errors << "\n";
+    std::cout << "replay time: " << ms.count() << " ms\n";
+
+    if (total.num_scheduled != 0)
+    {
+        // NOTE: a large lag means the replayed load shape doesn't match the recorded one
+        using Milliseconds = std::chrono::duration<double, std::milli>;
+        std::cout << "behind schedule: max " << Milliseconds(total.max_lag).count() << " ms, mean "
+                  << Milliseconds(total.total_lag).count() / static_cast<double>(total.num_scheduled) << " ms\n";
+    }
+
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     cxxopts::Options options(argv[0], "TCP Echo Client");
 
-    options.add_options()("b,benchmark", "Benchmark server", cxxopts::value<bool>()->default_value("false"))("h,help", "Print usage");
+    options.add_options()("b,benchmark", "Benchmark server", cxxopts::value<bool>()->default_value("false"))("r,replay", "Replay capture file against server", cxxopts::value<std::string>())("s,speed", "Replay speed relative to recorded pacing (0: as fast as possible)", cxxopts::value<double>()->default_value("1"))("t,threads", "Number of replay threads", cxxopts::value<unsigned int>()->default_value("10"))("h,help", "Print usage");
 
     const auto args = options.parse(argc, argv);
 
@@ -201,7 +589,9 @@ int main(int argc, char **argv)
         return 0;
     }
 
-    if (args["benchmark"].as<bool>() == true)
+    if (args.count("replay"))
+        return replay_capture(args["replay"].as<std::string>(), args["speed"].as<double>(), std::max(args["threads"].as<unsigned int>(), 1u));
+    else if (args["benchmark"].as<bool>() == true)
         benchmark_server();
     else
         return interactive_client();
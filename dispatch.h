@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <algorithm>
+#include <limits>
+#include <span>
+#include <type_traits>
+
+#include "messages.h"
+
+// Compile-time registry of the message types handled by an endpoint.
+// Generates a dispatch table indexed by message type (covering every
+// possible type value, so lookup needs no bounds check). Each entry holds
+// the frame size bounds of its type, checked on the header alone before
+// reading the body, and a handler that validates the body and hands a
+// zero-copy view to the message handler. Unregistered types have an
+// empty size range, so their frames are rejected on the header.
+template <typename... MsgTypes>
+struct MessageRegistry
+{
+    static_assert(sizeof...(MsgTypes) > 0);
+
+    using TypeIndex = std::underlying_type_t<MessageHeader::MessageType>;
+    static constexpr std::size_t NumTypes = std::size_t{std::numeric_limits<TypeIndex>::max()} + 1;
+
+    // size of the receive buffer required to hold any registered message
+    static constexpr std::size_t BufferSize = std::max({sizeof(MsgTypes)...});
+
+    template <typename... Args>
+    using HandlerFn = bool (*)(std::span<std::uint8_t> frame, Args... args);
+
+    template <typename... Args>
+    struct DispatchEntry
+    {
+        std::size_t min_size = 1; // empty range: rejects any frame
+        std::size_t max_size = 0;
+        HandlerFn<Args...> handle = &reject<Args...>;
+
+        // cheap check on the header alone, before reading the body
+        constexpr bool is_valid_header(const MessageHeader &header) const
+        {
+            return header.size >= min_size && header.size <= max_size;
+        }
+    };
+
+    template <typename... Args>
+    using DispatchTable = std::array<DispatchEntry<Args...>, NumTypes>;
+
+    static constexpr TypeIndex index(MessageHeader::MessageType type)
+    {
+        return static_cast<TypeIndex>(type);
+    }
+
+    // Handler must provide a static handle(MessageView<MsgType>, Args...)
+    // overload for each registered message type
+    template <typename Handler, typename... Args>
+    static constexpr DispatchTable<Args...> make_dispatch_table()
+    {
+        DispatchTable<Args...> table{};
+        ((table[index(MsgTypes::Type)] = {MessageTraits<MsgTypes>::MinSize, MessageTraits<MsgTypes>::MaxSize, &dispatch<MsgTypes, Handler, Args...>}), ...);
+        return table;
+    }
+
+private:
+    static_assert([]
+                  {
+                      constexpr std::array types = {MsgTypes::Type...};
+                      for (std::size_t i = 0; i != types.size(); ++i)
+                          for (std::size_t j = i + 1; j != types.size(); ++j)
+                              if (types[i] == types[j])
+                                  return false;
+                      return true; }(),
+                  "message types must be registered only once");
+
+    template <typename MsgType, typename Handler, typename... Args>
+    static bool dispatch(std::span<std::uint8_t> frame, Args... args)
+    {
+        const auto view = MessageView<MsgType>::from_frame(frame);
+        if (view.has_value() == false)
+            return false;
+
+        return Handler::handle(view.value(), args...);
+    }
+
+    template <typename... Args>
+    static bool reject(std::span<std::uint8_t>, Args...)
+    {
+        return false;
+    }
+};
+
+// Receive buffer large enough for any message in the given registry
+template <typename Registry>
+using RecvBuffer = std::array<std::uint8_t, Registry::BufferSize>;
@@ -0,0 +1,98 @@
+#include "dispatch.h"
+
+#include <cstring>
+
+#define BOOST_TEST_MODULE Dispatch Tests
+#include <boost/test/included/unit_test.hpp>
+
+using TestMessages = MessageRegistry<LoginRequestMsg, EchoRequestMsg>;
+
+struct TestHandler
+{
+    static bool handle(MessageView<LoginRequestMsg> req, MessageHeader::MessageType &handled_type)
+    {
+        handled_type = req.header().type;
+        return true;
+    }
+
+    static bool handle(MessageView<EchoRequestMsg> req, MessageHeader::MessageType &handled_type)
+    {
+        handled_type = req.header().type;
+        return true;
+    }
+};
+
+constexpr auto TestDispatchTable = TestMessages::make_dispatch_table<TestHandler, MessageHeader::MessageType &>();
+
+BOOST_AUTO_TEST_CASE(header_check_test)
+{
+    static_assert(TestMessages::BufferSize == sizeof(EchoRequestMsg));
+
+    auto is_valid_header = [](MessageHeader::MessageType type, std::size_t size)
+    {
+        const MessageHeader header{static_cast<MessageHeader::SizeType>(size), type, 0};
+        return TestDispatchTable[TestMessages::index(type)].is_valid_header(header);
+    };
+
+    // fixed size messages must match their size exactly
+    BOOST_TEST(is_valid_header(MessageHeader::MessageType::LoginRequest, sizeof(LoginRequestMsg)) == true);
+    BOOST_TEST(is_valid_header(MessageHeader::MessageType::LoginRequest, sizeof(LoginRequestMsg) - 1) == false);
+    BOOST_TEST(is_valid_header(MessageHeader::MessageType::LoginRequest, std::numeric_limits<MessageHeader::SizeType>::max()) == false);
+
+    // variable size messages within their own bounds
+    BOOST_TEST(is_valid_header(MessageHeader::MessageType::EchoRequest, sizeof(MessageHeader)) == false);
+    BOOST_TEST(is_valid_header(MessageHeader::MessageType::EchoRequest, sizeof(MessageHeader) + EchoBodyHeaderSize) == true);
+    BOOST_TEST(is_valid_header(MessageHeader::MessageType::EchoRequest, std::numeric_limits<MessageHeader::SizeType>::max()) == true);
+
+    // unregistered types are rejected regardless of size
+    BOOST_TEST(is_valid_header(MessageHeader::MessageType::EchoResponse, sizeof(MessageHeader) + EchoBodyHeaderSize) == false);
+    BOOST_TEST(is_valid_header(static_cast<MessageHeader::MessageType>(99), sizeof(LoginRequestMsg)) == false);
+}
+
+BOOST_AUTO_TEST_CASE(login_request_view_test)
+{
+    auto msg = make_msg<LoginRequestMsg>(0);
+    std::strcpy(msg.body.username.data(), "testuser");
+
+    const auto view = MessageView<LoginRequestMsg>::from_frame(msg_frame(msg));
+    BOOST_TEST(view.has_value() == true);
+    // views refer to the frame, not a copy
+    BOOST_TEST(&view->msg() == &msg);
+
+    msg.header.size = sizeof(LoginRequestMsg) - 1;
+    BOOST_TEST(MessageView<LoginRequestMsg>::from_frame(msg_frame(msg)).has_value() == false);
+}
+
+BOOST_AUTO_TEST_CASE(echo_request_view_test)
+{
+    auto msg = make_echo_req_msg(1, 4);
+    BOOST_TEST(MessageView<EchoRequestMsg>::from_frame(msg_frame(msg)).has_value() == true);
+
+    msg.body.msg_size = 5; // inconsistent with frame size
+    BOOST_TEST(MessageView<EchoRequestMsg>::from_frame(msg_frame(msg)).has_value() == false);
+
+    msg = make_echo_req_msg(1, 0);
+    BOOST_TEST(MessageView<EchoRequestMsg>::from_frame(msg_frame(msg)).has_value() == true);
+
+    msg.header.type = MessageHeader::MessageType::EchoResponse;
+    BOOST_TEST(MessageView<EchoRequestMsg>::from_frame(msg_frame(msg)).has_value() == false);
+}
+
+BOOST_AUTO_TEST_CASE(dispatch_table_test)
+{
+    auto handled_type = MessageHeader::MessageType::LoginResponse;
+
+    auto login_msg = make_msg<LoginRequestMsg>(0);
+    BOOST_TEST(TestDispatchTable[TestMessages::index(login_msg.header.type)].handle(msg_frame(login_msg), handled_type) == true);
+    BOOST_TEST((handled_type == MessageHeader::MessageType::LoginRequest));
+
+    auto echo_msg = make_echo_req_msg(1, 4);
+    BOOST_TEST(TestDispatchTable[TestMessages::index(echo_msg.header.type)].handle(msg_frame(echo_msg), handled_type) == true);
+    BOOST_TEST((handled_type == MessageHeader::MessageType::EchoRequest));
+
+    // unregistered message types are rejected
+    auto rsp_msg = make_echo_rsp_msg(echo_msg.header);
+    handled_type = MessageHeader::MessageType::LoginResponse;
+    BOOST_TEST(TestDispatchTable[TestMessages::index(rsp_msg.header.type)].handle(msg_frame(rsp_msg), handled_type) == false);
+    BOOST_TEST((handled_type == MessageHeader::MessageType::LoginResponse));
+}
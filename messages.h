@@ -1,9 +1,13 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
 #include <array>
+#include <algorithm>
 #include <limits>
 #include <optional>
+#include <span>
+#include <type_traits>
 
 #pragma pack(push, 1)
 
@@ -27,6 +31,7 @@ struct MessageHeader
 template <typename BodyType, MessageHeader::MessageType MsgType>
 struct Message
 {
+    using Body = BodyType;
     static constexpr auto Type = MsgType;
 
     MessageHeader header;
@@ -82,6 +87,14 @@ MsgType make_msg(MessageHeader::SequenceType seq, std::optional<MessageHeader::S
     return msg;
 }
 
+// Bytes of a message on the wire (as given by its header size)
+template <typename MsgType>
+auto msg_frame(MsgType &msg)
+{
+    using ByteType = std::conditional_t<std::is_const_v<MsgType>, const std::uint8_t, std::uint8_t>;
+    return std::span<ByteType>{reinterpret_cast<ByteType *>(&msg), msg.header.size};
+}
+
 constexpr auto EchoBodyHeaderSize = sizeof(EchoMessageBody) - EchoMessageBody::MaxMsgSize;
 
 template <typename EchoMsgType>
@@ -102,3 +115,82 @@ inline EchoResponseMsg make_echo_rsp_msg(const MessageHeader &echo_req_msg_heade
     const auto msg_size = echo_req_msg_header.size - sizeof(MessageHeader) - EchoBodyHeaderSize;
     return make_echo_msg<EchoResponseMsg>(echo_req_msg_header.seq, msg_size);
 }
+
+inline EchoResponseMsg &make_echo_rsp_msg(EchoRequestMsg &echo_req_msg)
+{
+    // NOTE: request & response share the same layout and size, so the
+    // request frame is reused inplace as the response (no copy)
+    static_assert(sizeof(EchoRequestMsg) == sizeof(EchoResponseMsg));
+    auto &rsp = reinterpret_cast<EchoResponseMsg &>(echo_req_msg);
+    rsp.header.type = EchoResponseMsg::Type;
+    return rsp;
+}
+
+// Body size bounds & validation used to reject malformed frames.
+// Fixed size bodies must match their struct size exactly.
+template <typename BodyType>
+struct BodyTraits
+{
+    static constexpr std::size_t MinSize = sizeof(BodyType);
+    static constexpr std::size_t MaxSize = sizeof(BodyType);
+
+    static constexpr bool is_valid(const BodyType &, std::size_t) { return true; }
+};
+
+// Echo bodies are variable size: msg_size must match the size of the frame
+template <>
+struct BodyTraits<EchoMessageBody>
+{
+    static constexpr std::size_t MinSize = EchoBodyHeaderSize;
+    static constexpr std::size_t MaxSize = sizeof(EchoMessageBody);
+
+    static constexpr bool is_valid(const EchoMessageBody &body, std::size_t body_size)
+    {
+        return body.msg_size == body_size - EchoBodyHeaderSize;
+    }
+};
+
+template <typename MsgType>
+struct MessageTraits
+{
+    using Body = BodyTraits<typename MsgType::Body>;
+
+    static constexpr std::size_t MinSize = sizeof(MessageHeader) + Body::MinSize;
+    // NOTE: frame size is bounded by the header size field as well
+    static constexpr std::size_t MaxSize = std::min<std::size_t>(sizeof(MessageHeader) + Body::MaxSize, std::numeric_limits<MessageHeader::SizeType>::max());
+
+    static bool is_valid(std::span<const std::uint8_t> frame)
+    {
+        if (frame.size() < MinSize || frame.size() > MaxSize)
+            return false;
+
+        const auto &msg = *reinterpret_cast<const MsgType *>(frame.data());
+        return msg.header.size == frame.size() && msg.header.type == MsgType::Type &&
+               Body::is_valid(msg.body, frame.size() - sizeof(MessageHeader));
+    }
+};
+
+// Zero-copy view over a validated frame in a receive buffer.
+// NOTE: the buffer must outlive the view and be large enough to hold
+// sizeof(MsgType) bytes, even if only frame.size() bytes are valid.
+template <typename MsgType>
+class MessageView
+{
+public:
+    static std::optional<MessageView> from_frame(std::span<std::uint8_t> frame)
+    {
+        if (MessageTraits<MsgType>::is_valid(frame) == false)
+            return std::nullopt;
+
+        return MessageView{*reinterpret_cast<MsgType *>(frame.data())};
+    }
+
+    MsgType &msg() const { return msg_; }
+    MessageHeader &header() const { return msg_.header; }
+    typename MsgType::Body &body() const { return msg_.body; }
+
+private:
+    explicit MessageView(MsgType &msg) : msg_{msg} {}
+
+    MsgType &msg_;
+};
@@ -3,7 +3,9 @@
 #include <cstdint>
 #include <span>
 #include <cassert>
+#include <cerrno>
 #include <optional>
+#include <type_traits>
 #include <sys/socket.h>
 
 constexpr int SERVER_PORT = 8080;
@@ -11,7 +13,24 @@ constexpr int SERVER_PORT = 8080;
 template <bool check_bytes_read, typename MsgType, typename TransferOp>
 bool transfer_helper(const int socket, MsgType &msg, const std::size_t msg_size, TransferOp op)
 {
-    const auto bytes_transferred = op(socket, &msg, msg_size, 0);
+    using BytePtr = std::conditional_t<std::is_const_v<MsgType>, const std::uint8_t *, std::uint8_t *>;
+    const auto data = reinterpret_cast<BytePtr>(&msg);
+
+    // NOTE: a single send/recv may transfer fewer bytes than requested (e.g.
+    // a frame arriving in several TCP segments), so keep going until all the
+    // bytes are transferred or the connection is closed or fails
+    std::size_t bytes_transferred = 0;
+    while (bytes_transferred != msg_size)
+    {
+        const auto ret = op(socket, data + bytes_transferred, msg_size - bytes_transferred, 0);
+        if (ret > 0)
+            bytes_transferred += static_cast<std::size_t>(ret);
+        else if (ret == -1 && errno == EINTR)
+            continue;
+        else
+            break;
+    }
+
     const auto ret = bytes_transferred == msg_size;
     if constexpr (check_bytes_read == true)
         assert(ret == true);
@@ -29,3 +48,15 @@ bool recv_msg(const int socket, MsgType &msg, const std::optional<std::size_t> s
 {
     return transfer_helper<check_bytes_read>(socket, msg, size.value_or(sizeof(MsgType)), recv);
 }
+
+template <bool check_bytes_read = true>
+bool send_buffer(const int socket, std::span<const std::uint8_t> buffer)
+{
+    return transfer_helper<check_bytes_read>(socket, *buffer.data(), buffer.size(), send);
+}
+
+template <bool check_bytes_read = true>
+bool recv_buffer(const int socket, std::span<std::uint8_t> buffer)
+{
+    return transfer_helper<check_bytes_read>(socket, *buffer.data(), buffer.size(), recv);
+}
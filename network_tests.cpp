@@ -0,0 +1,64 @@
+#include "network.h"
+#include "messages.h"
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <unistd.h>
+
+#define BOOST_TEST_MODULE Network Tests
+#include <boost/test/included/unit_test.hpp>
+
+struct SocketPair
+{
+    SocketPair() { BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets.data()) == 0); }
+    ~SocketPair()
+    {
+        for (const auto socket : sockets)
+            if (socket != -1)
+                close(socket);
+    }
+
+    std::array<int, 2> sockets = {-1, -1};
+};
+
+BOOST_AUTO_TEST_CASE(recv_frame_in_pieces_test)
+{
+    auto msg = make_echo_req_msg(1, 1000);
+    std::memset(msg.body.message.data(), 'x', msg.body.msg_size);
+    const auto frame = msg_frame(std::as_const(msg));
+
+    SocketPair pair;
+
+    // send the frame in two pieces, with a delay in between, so that the
+    // first recv returns before the whole frame is available
+    std::jthread sender([&pair, frame]()
+                        {
+                            send_buffer<false>(pair.sockets[0], frame.first(frame.size() / 2));
+                            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                            send_buffer<false>(pair.sockets[0], frame.subspan(frame.size() / 2)); });
+
+    EchoRequestMsg rsp;
+    BOOST_TEST((recv_msg<MessageHeader, false>(pair.sockets[1], rsp.header) == true));
+    BOOST_TEST(rsp.header.size == msg.header.size);
+
+    const std::span<std::uint8_t> rsp_body{reinterpret_cast<std::uint8_t *>(&rsp.body), rsp.header.size - sizeof(MessageHeader)};
+    BOOST_TEST(recv_buffer<false>(pair.sockets[1], rsp_body) == true);
+    BOOST_TEST(std::memcmp(&rsp, &msg, msg.header.size) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(recv_closed_connection_test)
+{
+    SocketPair pair;
+
+    // peer closes the connection after sending part of the frame
+    const std::array<std::uint8_t, 2> partial_header = {6, 0};
+    BOOST_TEST(send_buffer<false>(pair.sockets[0], partial_header) == true);
+    close(pair.sockets[0]);
+    pair.sockets[0] = -1;
+
+    MessageHeader header;
+    BOOST_TEST((recv_msg<MessageHeader, false>(pair.sockets[1], header) == false));
+}
@@ -1,13 +1,19 @@
 #include <iostream>
 #include <map>
 #include <thread>
-#include <cassert>
+#include <span>
+#include <optional>
+#include <cstdlib>
+#include <csignal>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 
 #include "messages.h"
+#include "dispatch.h"
 #include "network.h"
 #include "cipher.h"
+#include "capture.h"
 #include "external/cxxopts.hpp"
 
 constexpr int MAX_CLIENTS = 10;
@@ -19,54 +25,93 @@ struct LoginInfo
     LoginRequestBody::PasswordType password;
 };
 
-bool handle_request(const int client_socket, LoginInfo &login_info)
+// messages handled by the server
+using ServerMessages = MessageRegistry<LoginRequestMsg, EchoRequestMsg>;
+
+struct RequestHandler
+{
+    static bool handle(MessageView<LoginRequestMsg> req, const int client_socket, LoginInfo &login_info)
+    {
+        if (login_info.logged == true)
+            return false; // already logged in
+
+        // update login info
+        login_info.logged = true;
+        login_info.username = req.body().username;
+        login_info.password = req.body().password;
+
+        auto rsp = make_msg<LoginResponseMsg>(req.header().seq);
+        rsp.body.status_code = LoginResponseBody::StatusCodeType::Ok;
+        send_msg(client_socket, rsp);
+
+        return true;
+    }
+
+    static bool handle(MessageView<EchoRequestMsg> req, const int client_socket, LoginInfo &login_info)
+    {
+        if (login_info.logged == false)
+            return false; // login required
+
+        // NOTE: decrypt inplace in the receive buffer and then send it
+        // back as the response
+        cipher_helper({req.body().message.data(), req.body().msg_size}, req.header().seq, login_info.username, login_info.password);
+
+        send_msg(client_socket, make_echo_rsp_msg(req.msg()));
+
+        return true;
+    }
+};
+
+constexpr auto RequestDispatchTable = ServerMessages::make_dispatch_table<RequestHandler, int, LoginInfo &>();
+
+void close_connection(const int client_socket, CaptureWriter *capture)
+{
+    // NOTE: record before closing, as the socket fd (used as connection id)
+    // may be reused by a new connection as soon as it's closed
+    if (capture != nullptr)
+        capture->record_close(client_socket);
+    close(client_socket);
+}
+
+bool handle_request(const int client_socket, LoginInfo &login_info, CaptureWriter *capture)
 {
-    MessageHeader msg_header;
+    RecvBuffer<ServerMessages> buffer; // do not zero-initialize for performance reasons (we only use the frame size)
+
+    auto &msg_header = *reinterpret_cast<MessageHeader *>(buffer.data());
     const auto ret = recv_msg<MessageHeader, false>(client_socket, msg_header);
 
     if (ret == false)
     {
         // client closed the connection
         std::cout << "Client disconnected" << std::endl;
-        close(client_socket);
+        close_connection(client_socket, capture);
         return false;
     }
 
-    if (msg_header.type == MessageHeader::MessageType::LoginRequest)
-    {
-        assert(login_info.logged == false);
-
-        LoginRequestBody login_request;
-        assert(msg_header.size - sizeof(msg_header) == sizeof(login_request));
-        recv_msg(client_socket, login_request);
+    const auto &dispatch_entry = RequestDispatchTable[ServerMessages::index(msg_header.type)];
+    const std::span<std::uint8_t> frame{buffer.data(), msg_header.size};
 
-        // update login info
-        login_info.logged = true;
-        login_info.username = login_request.username;
-        login_info.password = login_request.password;
+    // reject unknown types & out of bounds sizes on the header alone, before
+    // reading the body (so that it fits in the buffer), and then let the
+    // handler for the message type validate the body
+    auto valid = dispatch_entry.is_valid_header(msg_header) == true &&
+                 recv_buffer<false>(client_socket, frame.subspan(sizeof(MessageHeader))) == true;
 
-        auto rsp = make_msg<LoginResponseMsg>(msg_header.seq);
-        rsp.body.status_code = LoginResponseBody::StatusCodeType::Ok;
-        send_msg(client_socket, rsp);
-    }
-    else if (msg_header.type == MessageHeader::MessageType::EchoRequest)
+    if (valid == true)
     {
-        assert(login_info.logged == true);
-        assert(msg_header.size - sizeof(msg_header) >= sizeof(EchoMessageBody::MsgSizeType));
-
-        // read the body of the echo request msg
-        // NOTE: we read into the response msg's body in order
-        // to decrypt inplace and then send back
-        auto rsp = make_echo_rsp_msg(msg_header);
-        recv_msg(client_socket, rsp.body, rsp.header.size - sizeof(MessageHeader));
-        assert(rsp.body.msg_size == rsp.header.size - sizeof(MessageHeader) - sizeof(EchoMessageBody::MsgSizeType));
+        // NOTE: record before dispatching, as handlers may modify the frame inplace
+        if (capture != nullptr)
+            capture->record_frame(client_socket, frame);
 
-        cipher_helper({rsp.body.message.data(), rsp.body.msg_size}, msg_header.seq, login_info.username, login_info.password);
+        valid = dispatch_entry.handle(frame, client_socket, login_info);
+    }
 
-        send_msg(client_socket, rsp);
+    if (valid == false)
+    {
+        std::cout << "Malformed request, closing connection" << std::endl;
+        close_connection(client_socket, capture);
+        return false;
     }
-    else
-        assert(false); // unknown request type
 
     return true;
 }
@@ -85,7 +130,7 @@ int accept_connection(const int server_socket)
     return client_socket;
 }
 
-void threaded_server(const int server_socket)
+void threaded_server(const int server_socket, CaptureWriter *capture)
 {
     while (true)
     {
@@ -94,15 +139,15 @@ void threaded_server(const int server_socket)
             continue;
 
         // launch & detach from thread to handle client connection
-        std::thread([client_socket]()
+        std::thread([client_socket, capture]()
                     {
                         LoginInfo login_info;
-                        while(handle_request(client_socket, login_info) == true); })
+                        while(handle_request(client_socket, login_info, capture) == true); })
             .detach();
     }
 }
 
-void io_socket_multiplexing_server(const int server_socket)
+void io_socket_multiplexing_server(const int server_socket, CaptureWriter *capture)
 {
     std::map<int, LoginInfo> clients;
 
@@ -143,7 +188,7 @@ void io_socket_multiplexing_server(const int server_socket)
 
             if (FD_ISSET(client_socket, &read_set))
             {
-                auto ret = handle_request(client_socket, it->second);
+                auto ret = handle_request(client_socket, it->second, capture);
                 if (ret == false)
                     it = clients.erase(it);
                 else
@@ -155,14 +200,14 @@ void io_socket_multiplexing_server(const int server_socket)
     }
 
     for (auto [client_socket, _] : clients)
-        close(client_socket);
+        close_connection(client_socket, capture);
 }
 
 int main(int argc, char **argv)
 {
     cxxopts::Options options(argv[0], "TCP Echo Server");
 
-    options.add_options()("t,threaded", "Threaded server version", cxxopts::value<bool>()->default_value("false"))("h,help", "Print usage");
+    options.add_options()("t,threaded", "Threaded server version", cxxopts::value<bool>()->default_value("false"))("c,capture", "Record received traffic into capture file", cxxopts::value<std::string>())("capture-credentials", "Record login credentials in plaintext in the capture file (replaced by placeholders by default)", cxxopts::value<bool>()->default_value("false"))("h,help", "Print usage");
 
     const auto args = options.parse(argc, argv);
 
@@ -198,17 +243,52 @@ int main(int argc, char **argv)
         return -1;
     }
 
+    std::optional<CaptureWriter> capture;
+    if (args.count("capture"))
+    {
+        // flush the capture on shutdown: signals are blocked here (before
+        // any other thread is spawned, including the capture writer thread,
+        // so that they inherit the mask) and handled synchronously by a
+        // dedicated thread
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        const auto capture_path = args["capture"].as<std::string>();
+        const auto credentials = args["capture-credentials"].as<bool>() == true ? CaptureWriter::Credentials::Keep : CaptureWriter::Credentials::Redact;
+        capture.emplace(capture_path, CaptureWriter::DefaultBufferSize, credentials);
+        if (capture->is_open() == false)
+        {
+            close(server_socket);
+            return -1;
+        }
+        std::cout << "Recording traffic into " << capture_path << std::endl;
+        if (credentials == CaptureWriter::Credentials::Keep)
+            std::cout << "WARNING: login credentials are recorded in plaintext" << std::endl;
+
+        std::thread([signals, &capture]()
+                    {
+                        int signal;
+                        sigwait(&signals, &signal);
+                        capture->flush();
+                        std::_Exit(0); })
+            .detach();
+    }
+    const auto capture_writer = capture.has_value() == true ? &capture.value() : nullptr;
+
     std::cout << "Server listening on port " << SERVER_PORT << std::endl;
 
     if (args["threaded"].as<bool>() == true)
     {
         std::cout << "Threaded server version" << std::endl;
-        threaded_server(server_socket);
+        threaded_server(server_socket, capture_writer);
     }
     else
     {
         std::cout << "IO socket multiplexing server version" << std::endl;
-        io_socket_multiplexing_server(server_socket);
+        io_socket_multiplexing_server(server_socket, capture_writer);
     }
 
     close(server_socket);